@@ -10,6 +10,10 @@ size_t ConfigParser::cpu_limit = std::thread::hardware_concurrency();
 size_t ConfigParser::thread_limit = 256;
 std::string ConfigParser::host = "127.0.0.1";
 size_t ConfigParser::port = 80;
+std::string ConfigParser::warmup = "off";
+size_t ConfigParser::warmup_max_file_size = 1024 * 1024;
+size_t ConfigParser::warmup_budget = 256 * 1024 * 1024;
+std::string ConfigParser::warmup_pattern = "*";
 
 ConfigParser::conf ConfigParser::parse(const std::string& conf_path) {
     std::ifstream conf_file(conf_path);
@@ -22,6 +26,13 @@ ConfigParser::conf ConfigParser::parse(const std::string& conf_path) {
             break;
         }
 
+        // strip a trailing comment and whitespace
+        line = line.substr(0, line.find('#'));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty()) {
+            continue;
+        }
+
         size_t space_position = line.find_first_of(' ');
 
         if (line.substr(0, space_position) == "cpu_limit") {
@@ -47,6 +58,22 @@ ConfigParser::conf ConfigParser::parse(const std::string& conf_path) {
         if (line.substr(0, space_position) == "port") {
             port = stoi(line.substr(space_position + 1, line.size() - space_position));
         }
+
+        if (line.substr(0, space_position) == "warmup") {
+            warmup = line.substr(space_position + 1, line.size() - space_position);
+        }
+
+        if (line.substr(0, space_position) == "warmup_max_file_size") {
+            warmup_max_file_size = stoull(line.substr(space_position + 1, line.size() - space_position));
+        }
+
+        if (line.substr(0, space_position) == "warmup_budget") {
+            warmup_budget = stoull(line.substr(space_position + 1, line.size() - space_position));
+        }
+
+        if (line.substr(0, space_position) == "warmup_pattern") {
+            warmup_pattern = line.substr(space_position + 1, line.size() - space_position);
+        }
     }
     
     conf c;
@@ -55,5 +82,9 @@ ConfigParser::conf ConfigParser::parse(const std::string& conf_path) {
     c.thread_limit = thread_limit;
     c.host = host;
     c.port = port;
+    c.warmup = warmup;
+    c.warmup_max_file_size = warmup_max_file_size;
+    c.warmup_budget = warmup_budget;
+    c.warmup_pattern = warmup_pattern;
     return c;
 }
\ No newline at end of file
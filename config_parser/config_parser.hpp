@@ -13,6 +13,10 @@ public:
         size_t thread_limit;
         std::string host;
         size_t port;
+        std::string warmup;
+        size_t warmup_max_file_size;
+        size_t warmup_budget;
+        std::string warmup_pattern;
     };
     static conf parse(const std::string& conf_path);
 private:
@@ -21,6 +25,10 @@ private:
     static size_t thread_limit;
     static std::string host;
     static size_t port;
+    static std::string warmup;
+    static size_t warmup_max_file_size;
+    static size_t warmup_budget;
+    static std::string warmup_pattern;
 };
 
 #endif // CONFIG_PARSER_HPP
\ No newline at end of file
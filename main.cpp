@@ -10,7 +10,19 @@ int main(int argc, char** argv) {
     auto conf = ConfigParser::parse(argv[1]);
     BOOST_LOG_TRIVIAL(info) << "DOCUMENT_ROOT: " << conf.document_root;
 
-    server s(conf.host, conf.port, conf.cpu_limit - 1, conf.document_root);
+    warmup_options warmup;
+    if (conf.warmup == "on") {
+      warmup.mode = warmup_mode::ON;
+    } else if (conf.warmup == "background") {
+      warmup.mode = warmup_mode::BACKGROUND;
+    } else if (conf.warmup != "off") {
+      BOOST_LOG_TRIVIAL(warning) << "Unknown warmup mode '" << conf.warmup << "', warm-up is off";
+    }
+    warmup.max_file_size = conf.warmup_max_file_size;
+    warmup.budget = conf.warmup_budget;
+    warmup.pattern = conf.warmup_pattern;
+
+    server s(conf.host, conf.port, conf.cpu_limit - 1, conf.document_root, warmup);
     return s.run();
   } else {
     BOOST_LOG_TRIVIAL(error) << "No path to configure file";
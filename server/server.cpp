@@ -4,20 +4,58 @@
 #include <utility>
 #include <boost/filesystem.hpp>
 #include <cstdlib>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <condition_variable>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
 
 #include "server.hpp"
 
 namespace fs = boost::filesystem;
 
 std::string server::_document_root = "/var/www/html";
+single_flight<std::string, server::source> server::_lookups;
+
+struct server::warmup_state {
+    std::chrono::steady_clock::time_point begin;
+    // directories which are queued or being walked
+    std::atomic<std::size_t> pending{0};
+    std::atomic<std::size_t> files{0};
+    std::atomic<std::size_t> prefetched{0};
+    // bytes left for prefetching
+    std::atomic<std::size_t> budget{0};
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done = false;
+
+    // logs the duration and wakes up run() waiting for the warm-up
+    void finish() {
+        try {
+            auto time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - begin).count();
+            BOOST_LOG_TRIVIAL(info) << "Warm-up finished in " << time << "ms: "
+                << files << " files found, " << prefetched << " bytes prefetched";
+        } catch (...) {}
+        {
+            std::unique_lock<std::mutex> ul(mtx);
+            done = true;
+        }
+        cv.notify_all();
+    }
+};
 
 server::server(const std::string& address, std::uint16_t port, 
-    std::size_t num_of_threads, const std::string& doc_root)
+    std::size_t num_of_threads, const std::string& doc_root,
+    const warmup_options& warmup)
     : _address(address)
     , _port(port)
     , _number_of_threads(num_of_threads)
+    , _warmup(warmup)
     , _thread_pool()
     {
         _document_root = doc_root;
@@ -26,6 +64,10 @@ server::server(const std::string& address, std::uint16_t port,
 int server::run() {
     _thread_pool.start(_number_of_threads);
 
+    if (_warmup.mode != warmup_mode::OFF) {
+        warm_up();
+    }
+
     if (!event_init()) {
         BOOST_LOG_TRIVIAL(error) << "Failed to init libevent.";
         return EXIT_FAILURE;
@@ -49,6 +91,99 @@ int server::run() {
     return EXIT_SUCCESS;
 }
 
+void server::warm_up() {
+    boost::system::error_code ec;
+    if (!fs::is_directory(_document_root, ec)) {
+        BOOST_LOG_TRIVIAL(warning) << "Warm-up skipped, no such directory: " << _document_root;
+        return;
+    }
+
+    if (_number_of_threads == 0) {
+        BOOST_LOG_TRIVIAL(warning) << "Warm-up skipped, there are no worker threads";
+        return;
+    }
+
+    auto state = std::make_shared<warmup_state>();
+    state->begin = std::chrono::steady_clock::now();
+    state->budget = _warmup.budget;
+    state->pending = 1;
+
+    BOOST_LOG_TRIVIAL(info) << "Warm-up of " << _document_root << " started";
+    _thread_pool.enqueue([this, state] { warm_up_directory(state, _document_root); });
+
+    if (_warmup.mode == warmup_mode::BACKGROUND) {
+        return;
+    }
+    std::unique_lock<std::mutex> ul(state->mtx);
+    state->cv.wait(ul, [&] { return state->done; });
+}
+
+void server::warm_up_directory(std::shared_ptr<warmup_state> state, const fs::path& dir) {
+    // the directory is done even if walking it threw, otherwise run() waits forever
+    struct walked_guard {
+        warmup_state& state;
+        ~walked_guard() {
+            if (--state.pending == 0) {
+                state.finish();
+            }
+        }
+    } walked{*state};
+
+    boost::system::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        // symlinks are not followed to avoid cycles
+        auto status = it->symlink_status(ec);
+        if (ec) {
+            continue;
+        }
+        if (fs::is_directory(status)) {
+            ++state->pending;
+            try {
+                fs::path sub_dir = it->path();
+                _thread_pool.enqueue([this, state, sub_dir] { warm_up_directory(state, sub_dir); });
+            } catch (...) {
+                --state->pending;
+                throw;
+            }
+        } else if (fs::is_regular_file(status)) {
+            warm_up_file(*state, it->path());
+        }
+    }
+    if (ec) {
+        BOOST_LOG_TRIVIAL(warning) << "Warm-up failed to read " << dir.c_str() << ": " << ec.message();
+    }
+}
+
+void server::warm_up_file(warmup_state& state, const fs::path& file) {
+    // stat() alone warms the dentry and inode caches for find_source()
+    struct stat st;
+    if (stat(file.c_str(), &st) == -1) {
+        return;
+    }
+    std::size_t size = st.st_size;
+    ++state.files;
+
+    if (size == 0 || size > _warmup.max_file_size ||
+        fnmatch(_warmup.pattern.c_str(), file.filename().c_str(), 0) != 0) {
+        return;
+    }
+    // reserve the file size from the budget
+    auto left = state.budget.load();
+    while (left >= size && !state.budget.compare_exchange_weak(left, left - size)) {}
+    if (left < size) {
+        return;
+    }
+
+    int file_fd = open(file.c_str(), O_RDONLY);
+    if (file_fd == -1) {
+        return;
+    }
+    if (posix_fadvise(file_fd, 0, size, POSIX_FADV_WILLNEED) == 0) {
+        state.prefetched += size;
+    }
+    close(file_fd);
+}
+
  // Date: <day-name>, <day> <month> <year> <hour>:<minute>:<second> GMT
 std::string server::get_date() {
     std::time_t timer = std::time(nullptr);
@@ -70,11 +205,16 @@ void server::add_default_headers(evkeyvalq* headers){
     evhttp_add_header(headers, HTTP::HEADER::CONNECTION, "close");
 };
 
-std::pair<int,std::size_t> server::find_source(const std::string& root, const std::string& path) {
+std::string server::resolve_path(const std::string& root, const std::string& path) {
     fs::path fs_path = fs::path(root) / fs::path(path);
     if (path[path.length() - 1] == '/') {
         fs_path /= fs::path("index.html");
     }
+    return fs_path.string();
+}
+
+server::source server::find_source(const std::string& root, const std::string& path) {
+    fs::path fs_path = resolve_path(root, path);
     BOOST_LOG_TRIVIAL(debug) << "Full path to file: " << fs_path.c_str();
 
     int file_fd = open(fs_path.c_str(), O_RDONLY);
@@ -82,9 +222,16 @@ std::pair<int,std::size_t> server::find_source(const std::string& root, const st
     if (file_fd == -1) {
         return std::make_pair(file_fd, 0);
     }
-    
-    BOOST_LOG_TRIVIAL(debug) << "file_size: " << fs::file_size(fs_path);
-    return std::make_pair(file_fd, fs::file_size(fs_path));
+
+    boost::system::error_code ec;
+    auto file_size = fs::file_size(fs_path, ec);
+    if (ec) {
+        // e.g. a directory
+        close(file_fd);
+        return std::make_pair(-1, 0);
+    }
+    BOOST_LOG_TRIVIAL(debug) << "file_size: " << file_size;
+    return std::make_pair(file_fd, file_size);
 }
 
 std::string server::get_content_type(const std::string& path) {
@@ -125,7 +272,7 @@ bool server::is_safe_path(const std::string& path) {
     return false;
 }
 
-void server::handle_request(evhttp_request *req) {
+void server::handle_request(evhttp_request *req, thread_pool* tp) {
     bool is_index = false;
     auto out_headers = evhttp_request_get_output_headers(req);
     add_default_headers(out_headers);
@@ -171,12 +318,55 @@ void server::handle_request(evhttp_request *req) {
         return;
     }
 
-    auto result = server::find_source(_document_root, decoded_path);
+    std::string path_str(decoded_path);
+    _lookups.run(resolve_path(_document_root, path_str),
+        [path_str] { return find_source(_document_root, path_str); },
+        [req, path_str, is_index, tp] (const std::shared_future<source>& lookup, bool shared) {
+            source result;
+            try {
+                result = lookup.get();
+            } catch (const std::exception& e) {
+                BOOST_LOG_TRIVIAL(error) << "Failed to find source: " << e.what();
+                BOOST_LOG_TRIVIAL(info) << HTTP_INTERNAL << ' ' << req->uri << std::endl;
+                evhttp_send_reply(req, HTTP_INTERNAL, nullptr, nullptr);
+                return;
+            }
+            // evbuffer_add_file() closes the descriptor, so every request needs its own
+            if (shared && result.first != -1) {
+                result.first = dup(result.first);
+                if (result.first == -1) {
+                    BOOST_LOG_TRIVIAL(error) << "Failed to dup descriptor: " << std::strerror(errno);
+                    BOOST_LOG_TRIVIAL(info) << HTTP_SERVUNAVAIL << ' ' << req->uri << std::endl;
+                    evhttp_send_reply(req, HTTP_SERVUNAVAIL, nullptr, nullptr);
+                    return;
+                }
+            }
+            // coalesced callers are notified on the thread which did the lookup,
+            // their replies are spread over the pool instead of being sent one by one
+            if (shared) {
+                try {
+                    tp->enqueue(send_source, req, path_str, is_index, result);
+                    return;
+                } catch (const std::exception& e) {
+                    BOOST_LOG_TRIVIAL(error) << "Failed to enqueue reply: " << e.what();
+                }
+            }
+            send_source(req, path_str, is_index, result);
+        });
+
+	if (decoded_uri)
+		evhttp_uri_free(decoded_uri);
+    if (decoded_path)
+		free(decoded_path);
+}
 
+void server::send_source(evhttp_request* req, const std::string& path, bool is_index,
+    const source& result) {
+    auto out_headers = evhttp_request_get_output_headers(req);
     auto out = evbuffer_new();
 
     if (result.first == -1) {
-        BOOST_LOG_TRIVIAL(debug) << "File not found: " << decoded_path;
+        BOOST_LOG_TRIVIAL(debug) << "File not found: " << path;
         if (is_index) {
             BOOST_LOG_TRIVIAL(info) << HTTP::FORBIDDEN << ' ' << req->uri << std::endl;
             evhttp_send_reply(req, HTTP::FORBIDDEN, nullptr, nullptr);
@@ -187,9 +377,11 @@ void server::handle_request(evhttp_request *req) {
     } else {
         if (req->type == EVHTTP_REQ_GET) {
             evbuffer_add_file(out, result.first, 0, result.second);
+        } else {
+            close(result.first);
         }
         // Add headers
-        auto content_type = get_content_type(decoded_path);
+        auto content_type = get_content_type(path);
         BOOST_LOG_TRIVIAL(debug) << "Content-type: " <<  content_type;
         evhttp_add_header(out_headers, HTTP::HEADER::CONTENT_TYPE, content_type.c_str());
 
@@ -200,11 +392,7 @@ void server::handle_request(evhttp_request *req) {
         BOOST_LOG_TRIVIAL(info) << HTTP_OK << ' ' << req->uri << std::endl;
         evhttp_send_reply(req, HTTP_OK, "OK", out);
     }
-    
-	if (decoded_uri)
-		evhttp_uri_free(decoded_uri);
-    if (decoded_path)
-		free(decoded_path);
+
     if (out)
 		evbuffer_free(out);
 }
\ No newline at end of file
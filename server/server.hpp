@@ -4,11 +4,14 @@
 
 #include <string>
 #include <utility>
+#include <memory>
 
 #include <evhttp.h>
+#include <boost/filesystem.hpp>
 
 #include "../logger/logger.hpp"
 #include "../thread_pool/thread_pool.hpp"
+#include "../single_flight/single_flight.hpp"
 
 #include <string>
 #include <unordered_map>
@@ -62,28 +65,54 @@ namespace HTTP {
 //     { HTTP::EXT::SWF  , HTTP::MIME::APPLICATION_X_SHOCKWAVE_FLASH },
 // };
 
+// Startup warm-up of document_root: OFF - disabled, ON - finish before the
+// listener accepts, BACKGROUND - accept traffic while warm-up continues.
+enum class warmup_mode { OFF, ON, BACKGROUND };
+
+struct warmup_options {
+    warmup_mode mode = warmup_mode::OFF;
+    // only files not bigger than this are prefetched into the page cache
+    std::size_t max_file_size = 1024 * 1024;
+    // total amount of bytes to prefetch
+    std::size_t budget = 256 * 1024 * 1024;
+    // fnmatch(3) pattern for file names to prefetch
+    std::string pattern = "*";
+};
+
 class server {
 public:
     static std::string _document_root;
 
+    // descriptor and size of a file found in document_root, descriptor is -1 if not found
+    using source = std::pair<int,std::size_t>;
+
+    // coalesces concurrent find_source() calls for the same resolved path
+    static single_flight<std::string, source> _lookups;
+
     server() = delete;
 
     server(
         const std::string& address,
         std::uint16_t port, 
         std::size_t num_of_threads,
-        const std::string& doc_root
+        const std::string& doc_root,
+        const warmup_options& warmup = warmup_options()
     );
 
     ~server() = default;
 
     int run();
 
-    static void handle_request(evhttp_request* req);
+    static void handle_request(evhttp_request* req, thread_pool* tp);
 
     static void add_default_headers(evkeyvalq* headers);
 
-    static std::pair<int,std::size_t> find_source(const std::string& root, const std::string& path);
+    static void send_source(evhttp_request* req, const std::string& path, bool is_index,
+        const source& result);
+
+    static std::string resolve_path(const std::string& root, const std::string& path);
+
+    static source find_source(const std::string& root, const std::string& path);
 
     static std::string get_date();
 
@@ -92,14 +121,25 @@ public:
     static bool is_safe_path(const std::string& path);
 
 private:
+    struct warmup_state;
+
     std::string _address;
     std::uint16_t _port;
     std::size_t _number_of_threads;
+    warmup_options _warmup;
     thread_pool _thread_pool;
 
+    // walks document_root in parallel on the thread pool
+    void warm_up();
+
+    void warm_up_directory(std::shared_ptr<warmup_state> state, const boost::filesystem::path& dir);
+
+    void warm_up_file(warmup_state& state, const boost::filesystem::path& file);
+
     void (*on_request)(evhttp_request* req, void* tp) = [] (evhttp_request *req, void* tp) {
         BOOST_LOG_TRIVIAL(info) << "New client has come with uri: " << req->uri;
-        static_cast<thread_pool*>(tp)->enqueue(handle_request, req);
+        auto pool = static_cast<thread_pool*>(tp);
+        pool->enqueue(handle_request, req, pool);
     };
 };
 
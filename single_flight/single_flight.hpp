@@ -0,0 +1,119 @@
+#ifndef SINGLE_FLIGHT_HPP
+#define SINGLE_FLIGHT_HPP
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// single_flight coalesces concurrent calls with the same key: the first caller
+// runs the function, callers which come while it is running do not wait, their
+// callbacks are queued and invoked with the shared result once the call completes.
+template<class Key, class Value>
+class single_flight {
+public:
+    // the result is a ready future, get() rethrows the exception thrown by the call;
+    // the second argument is true for callers which got a result computed by another call
+    using callback = std::function<void(const std::shared_future<Value>&, bool)>;
+
+    single_flight() = default;
+
+    // run( key, fn, cb ) calls fn() unless a call for key is already in flight.
+    // The callbacks of the coalesced callers are invoked on the thread which ran
+    // fn(), before the callback of that caller, so a callback which has work to
+    // do should hand it off to other threads. Exceptions thrown by their
+    // callbacks are swallowed, the one thrown by the caller's own callback is
+    // propagated.
+    void run(const Key& key, const std::function<Value()>& fn, const callback& cb);
+
+    ~single_flight() = default;
+private:
+    single_flight(const single_flight &) = delete;
+    single_flight(single_flight &&) = delete;
+
+    single_flight & operator=(const single_flight &) = delete;
+    single_flight & operator=(single_flight &&) = delete;
+
+    // removes the key from calls when the call is over, even if it failed:
+    class call_guard {
+    public:
+        call_guard(single_flight& flight, const Key& key) : flight(flight), key(key) {}
+
+        // release() removes the key and returns the callbacks queued for it
+        std::vector<callback> release() {
+            std::unique_lock<std::mutex> ul(flight.mtx);
+            released = true;
+            auto call = flight.calls.find(key);
+            auto waiters = std::move(call->second);
+            flight.calls.erase(call);
+            return waiters;
+        }
+
+        // if the call failed before its result was ready the waiters get an error
+        ~call_guard() {
+            if (released) return;
+            auto waiters = release();
+            try {
+                std::promise<Value> promise;
+                promise.set_exception(std::make_exception_ptr(
+                    std::runtime_error("single_flight call failed")));
+                notify(waiters, promise.get_future().share());
+            } catch (...) {}
+        }
+    private:
+        single_flight& flight;
+        const Key& key;
+        bool released = false;
+    };
+
+    // notify() invokes the callbacks of coalesced callers, a failing callback
+    // must not leave the other callers without a result
+    static void notify(const std::vector<callback>& waiters, const std::shared_future<Value>& result) {
+        for (auto&& waiter : waiters) {
+            try {
+                waiter(result, true);
+            } catch (...) {}
+        }
+    }
+
+    std::mutex mtx;
+    // keys in flight with callbacks of the callers waiting for them:
+    std::unordered_map<Key, std::vector<callback>> calls;
+};
+
+template<class Key, class Value>
+void single_flight<Key, Value>::run(const Key& key, const std::function<Value()>& fn, const callback& cb) {
+    {
+        std::unique_lock<std::mutex> ul(mtx);
+        auto call = calls.find(key);
+        if (call != calls.end()) {
+            call->second.push_back(cb);
+            return;
+        }
+        calls.emplace(key, std::vector<callback>());
+    }
+
+    std::shared_future<Value> result;
+    std::vector<callback> waiters;
+    {
+        call_guard guard(*this, key);
+
+        std::promise<Value> promise;
+        result = promise.get_future().share();
+        try {
+            promise.set_value(fn());
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+        waiters = guard.release();
+    }
+
+    notify(waiters, result);
+    cb(result, false);
+}
+
+#endif // SINGLE_FLIGHT_HPP
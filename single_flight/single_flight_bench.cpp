@@ -0,0 +1,133 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../logger/logger.hpp"
+#include "../server/server.hpp"
+#include "single_flight.hpp"
+
+// N concurrent clients hit one cold file through server::find_source():
+// ./single_flight_bench [clients]
+// Dropping the dentry and inode caches needs root, otherwise only the first
+// run is cold.
+namespace bench {
+namespace single_flight {
+
+std::atomic<std::size_t> lookups{0};
+
+server::source find_source(const std::string& root, const std::string& path) {
+    ++lookups;
+    return server::find_source(root, path);
+}
+
+// drops the page, dentry and inode caches
+bool make_cold() {
+    sync();
+    std::ofstream drop_caches("/proc/sys/vm/drop_caches");
+    drop_caches << "3" << std::endl;
+    return static_cast<bool>(drop_caches);
+}
+
+// starts all clients at once and returns the time until the last one got its
+// file; a client calls served() when it is answered, maybe from another thread
+template<class Client>
+long long run_clients(std::size_t clients, Client client) {
+    std::atomic<std::size_t> ready{0};
+    std::atomic<std::size_t> answered{0};
+    std::atomic<bool> go{false};
+    auto served = [&] { ++answered; };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < clients; ++i) {
+        threads.emplace_back([&] {
+            ++ready;
+            while (!go) {
+                std::this_thread::yield();
+            }
+            client(served);
+        });
+    }
+    while (ready != clients) {
+        std::this_thread::yield();
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    go = true;
+    while (answered != clients) {
+        std::this_thread::yield();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    for (auto&& thread : threads) {
+        thread.join();
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+}
+
+} // single_flight
+} // bench
+
+int main(int argc, char** argv) {
+    using namespace bench::single_flight;
+
+    boost::log::core::get()->set_filter(
+        boost::log::trivial::severity >= boost::log::trivial::warning
+    );
+
+    const std::size_t clients = argc > 1 ? std::stoul(argv[1]) : 1000;
+
+    char root[] = "/tmp/single_flight_bench_XXXXXX";
+    if (!mkdtemp(root)) {
+        std::cerr << "Failed to create temporary directory" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string path = "/release/index.html";
+    const std::string dir = std::string(root) + "/release";
+    mkdir(dir.c_str(), 0755);
+    std::ofstream(dir + "/index.html") << "<html></html>";
+
+    // every client does its own lookup
+    const char* cold = make_cold() ? "" : " (not cold)";
+    lookups = 0;
+    auto direct = run_clients(clients, [&] (const std::function<void()>& served) {
+        auto result = find_source(root, path);
+        if (result.first != -1) {
+            close(result.first);
+        }
+        served();
+    });
+    std::cout << "direct:    " << clients << " clients, " << lookups << " lookups, "
+        << direct << "us" << cold << std::endl;
+
+    // clients share one lookup, like server::handle_request() they do not wait for it
+    ::single_flight<std::string, server::source> flight;
+    cold = make_cold() ? "" : " (not cold)";
+    lookups = 0;
+    auto coalesced = run_clients(clients, [&] (const std::function<void()>& served) {
+        flight.run(server::resolve_path(root, path),
+            [&] { return find_source(root, path); },
+            [&, served] (const std::shared_future<server::source>& lookup, bool shared) {
+                auto result = lookup.get();
+                if (result.first != -1) {
+                    close(shared ? dup(result.first) : result.first);
+                }
+                served();
+            });
+    });
+    std::cout << "coalesced: " << clients << " clients, " << lookups << " lookups, "
+        << coalesced << "us" << cold << std::endl;
+
+    unlink((dir + "/index.html").c_str());
+    rmdir(dir.c_str());
+    rmdir(root);
+    return EXIT_SUCCESS;
+}